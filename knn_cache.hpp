@@ -0,0 +1,144 @@
+/* Result cache for repeated query images
+
+   A bounded LRU cache in front of the nearest neighbour search, keyed
+   by the pixel vector of the query image. A byte-identical resubmission
+   of an image already searched returns the stored neighbour list and
+   label without rescanning the training set.
+*/
+
+#ifndef KNN_CACHE_HPP
+#define KNN_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* Default capacity of the cache, in number of query images.
+
+   0 disables the cache, which is the default so that the benchmark
+   loops, which replay the same validation set, keep measuring the
+   kernels.
+*/
+#ifndef KNN_CACHE_CAPACITY
+#define KNN_CACHE_CAPACITY 0
+#endif
+
+template <typename Vector>
+class knn_cache {
+
+public:
+
+  // What is remembered about a query image
+  struct entry {
+    // Indices in the training set of the nearest images, closest first
+    std::vector<std::size_t> neighbours;
+    // The digit value guessed for the query image
+    int label;
+  };
+
+private:
+
+  // FNV-1a over the pixel values, cheap compared to a training set scan
+  struct pixel_hash {
+    std::size_t operator()(const Vector& v) const {
+      std::uint64_t h = 14695981039346656037ULL;
+      for (auto p : v) {
+        h ^= static_cast<std::uint32_t>(p);
+        h *= 1099511628211ULL;
+      }
+      return static_cast<std::size_t>(h);
+    }
+  };
+
+  using lru_list = std::list<std::pair<Vector, entry>>;
+
+  std::size_t capacity;
+  // Most recently used entries at the front
+  lru_list lru;
+  // The full pixel vector is the key so a hash collision can never
+  // return the result of another image
+  std::unordered_map<Vector, typename lru_list::iterator, pixel_hash> index;
+  // Bumped each time the training set changes, to drop the results of
+  // searches started against the previous one
+  std::size_t generation = 0;
+  std::mutex m;
+  std::atomic<std::size_t> hit_count { 0 };
+  std::atomic<std::size_t> miss_count { 0 };
+
+public:
+
+  knn_cache(std::size_t capacity = KNN_CACHE_CAPACITY) : capacity { capacity } {
+    index.reserve(capacity);
+  }
+
+  bool enabled() const { return capacity != 0; }
+
+  /* Look up the result for an image
+
+     Return true and fill res on a hit. The current generation is
+     returned in gen so that the result of the search done on a miss can
+     be given back to insert().
+  */
+  bool lookup(const Vector& pixels, entry& res, std::size_t& gen) {
+    gen = 0;
+    if (!enabled())
+      return false;
+    std::lock_guard<std::mutex> lock { m };
+    gen = generation;
+    auto it = index.find(pixels);
+    if (it == index.end()) {
+      miss_count++;
+      return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    res = it->second->second;
+    hit_count++;
+    return true;
+  }
+
+  /* Remember the result of a search
+
+     The result is dropped if the training set changed since the
+     lookup() that returned gen.
+  */
+  void insert(const Vector& pixels, const entry& res, std::size_t gen) {
+    if (!enabled())
+      return;
+    std::lock_guard<std::mutex> lock { m };
+    if (gen != generation)
+      return;
+    auto it = index.find(pixels);
+    if (it != index.end()) {
+      // Another thread searched the same image concurrently
+      it->second->second = res;
+      lru.splice(lru.begin(), lru, it->second);
+      return;
+    }
+    if (lru.size() == capacity) {
+      index.erase(lru.back().first);
+      lru.pop_back();
+    }
+    lru.emplace_front(pixels, res);
+    index.emplace(pixels, lru.begin());
+  }
+
+  // Forget every result, to be called when the training set changes
+  void invalidate() {
+    std::lock_guard<std::mutex> lock { m };
+    generation++;
+    index.clear();
+    lru.clear();
+  }
+
+  std::size_t hits() const { return hit_count; }
+
+  std::size_t misses() const { return miss_count; }
+
+};
+
+#endif // KNN_CACHE_HPP
@@ -0,0 +1,274 @@
+/* Training set condensation for nearest neighbour matching
+
+   Select the prototypes of the training set that are needed for the
+   1-NN decisions and write them out in the same CSV format, so that the
+   digit recognition programs only have to scan the reduced set:
+
+   - Wilson editing first drops the training images misclassified by
+     their 3 nearest neighbours, which are mostly noise;
+
+   - Hart condensing then only keeps the images that are misclassified
+     by the images already kept.
+
+   Usage: knn_condense [training.csv [condensed.csv]]
+*/
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <CL/sycl.hpp>
+
+using namespace cl::sycl;
+
+constexpr size_t pixel_number = 784;
+
+using Vector = std::array<int, pixel_number>;
+
+class CondenseKernel;
+
+struct Img {
+  // The digit value [0-9] represented on the image
+  int label;
+  // The 1D-linearized image pixels
+  Vector pixels;
+};
+
+std::vector<Img> training_set;
+std::vector<Img> validation_set;
+// Distances to each image of the training set
+std::vector<int> result;
+
+// Construct a SYCL buffer from a vector of images
+buffer<int> get_buffer(const std::vector<Img>& imgs) {
+  std::vector<int> res;
+  for (auto const& elem : imgs) {
+    res.insert(res.end(), std::begin(elem.pixels), std::end(elem.pixels));
+  }
+  return { std::begin(res), std::end(res) };
+}
+
+// Read a CSV-file containing image pixels
+std::vector<Img> slurp_file(const std::string& name) {
+  std::ifstream infile { name, std::ifstream::in };
+  std::string line, token;
+  std::vector<Img> res;
+  bool fst_1 = true;
+
+  while (std::getline(infile, line)) {
+    if (fst_1) {
+      fst_1 = false;
+      continue;
+    }
+    Img img;
+    std::istringstream iss { line };
+    bool fst = true;
+    int index = 0;
+    while (std::getline(iss, token, ',')) {
+      if (fst) {
+        img.label = std::stoi(token);
+        fst = false;
+      }
+      else {
+        img.pixels[index] = std::stoi(token);
+        index++;
+      }
+    }
+    res.push_back(img);
+  }
+  return res;
+}
+
+// Write the selected images to a CSV-file readable by slurp_file
+bool dump_file(const std::string& name, const std::vector<Img>& imgs,
+               const std::vector<bool>& selected) {
+  std::ofstream outfile { name, std::ofstream::out };
+  outfile << "label";
+  for (std::size_t i = 0; i != pixel_number; i++)
+    outfile << ",pixel" << i;
+  outfile << "\n";
+
+  for (std::size_t i = 0; i != imgs.size(); i++) {
+    if (!selected[i])
+      continue;
+    outfile << imgs[i].label;
+    for (auto p : imgs[i].pixels)
+      outfile << ',' << p;
+    outfile << "\n";
+  }
+  return static_cast<bool>(outfile);
+}
+
+// Compute in result the L2 distance between an image and each one from
+// the training set
+void distances(buffer<int>& training, buffer<int>& res_buffer,
+               const Vector& pixels, queue& q) {
+
+  {
+    buffer<int> A { std::begin(pixels), std::end(pixels) };
+    q.submit([&] (handler &cgh) {
+        // "training" is only transfered the first time the kernel is
+        // executed
+        auto train = training.get_access<access::mode::read>(cgh);
+        auto ka = A.get_access<access::mode::read>(cgh);
+        auto kb = res_buffer.get_access<access::mode::write>(cgh);
+        // Launch a kernel with one work-item per training image
+        cgh.parallel_for<class CondenseKernel>(range<1> { result.size() },
+                                               [=] (id<1> index) {
+            decltype(ka)::value_type diff = 0;
+            // For each pixel
+            for (auto i = 0; i != pixel_number; i++) {
+              auto toAdd = ka[i] - train[index[0]*pixel_number + i];
+              diff += toAdd*toAdd;
+            }
+            kb[index] = diff;
+          });
+      });
+  }
+
+  // Wait for the distances to be available in result
+  auto r = res_buffer.get_access<access::mode::read>();
+}
+
+/* Index of the training image closest to the last image given to
+   distances(), among the selected ones and without the excluded one
+
+   Return result.size() if there is no candidate.
+*/
+std::size_t nearest(const std::vector<bool>& selected,
+                    std::size_t excluded =
+                      std::numeric_limits<std::size_t>::max()) {
+  auto best = result.size();
+  for (std::size_t i = 0; i != result.size(); i++)
+    if (selected[i] && i != excluded
+        && (best == result.size() || result[i] < result[best]))
+      best = i;
+  return best;
+}
+
+/* Wilson editing: drop the images whose 3 nearest neighbours in the
+   training set vote for another digit
+*/
+std::vector<bool> edit(buffer<int>& training, buffer<int>& res_buffer,
+                       queue& q) {
+  std::vector<bool> all(training_set.size(), true);
+  std::vector<bool> kept(training_set.size(), true);
+
+  for (std::size_t i = 0; i != training_set.size(); i++) {
+    distances(training, res_buffer, training_set[i].pixels, q);
+    // Find the 3 nearest neighbours, the image itself excluded
+    std::vector<bool> candidates = all;
+    std::vector<int> labels;
+    for (int k = 0; k != 3; k++) {
+      auto n = nearest(candidates, i);
+      if (n == result.size())
+        break;
+      candidates[n] = false;
+      labels.push_back(training_set[n].label);
+    }
+    // Majority vote, the nearest neighbour wins a tie
+    auto voted = labels.empty() ? training_set[i].label : labels.front();
+    for (auto l : labels)
+      if (std::count(labels.begin(), labels.end(), l)
+          > std::count(labels.begin(), labels.end(), voted))
+        voted = l;
+    kept[i] = voted == training_set[i].label;
+  }
+  return kept;
+}
+
+/* Hart condensing: starting from one image per digit, add each
+   candidate image misclassified by the images already kept, until a
+   full pass adds nothing
+*/
+std::vector<bool> condense(buffer<int>& training, buffer<int>& res_buffer,
+                           queue& q, const std::vector<bool>& candidates) {
+  std::vector<bool> kept(training_set.size(), false);
+  std::map<int, bool> seen;
+  for (std::size_t i = 0; i != training_set.size(); i++)
+    if (candidates[i] && !seen[training_set[i].label]) {
+      seen[training_set[i].label] = true;
+      kept[i] = true;
+    }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (std::size_t i = 0; i != training_set.size(); i++) {
+      if (!candidates[i] || kept[i])
+        continue;
+      distances(training, res_buffer, training_set[i].pixels, q);
+      if (training_set[nearest(kept)].label != training_set[i].label) {
+        kept[i] = true;
+        changed = true;
+      }
+    }
+  }
+  return kept;
+}
+
+int main(int argc, char* argv[]) {
+  std::string input = argc > 1 ? argv[1] : "data/trainingsample.csv";
+  std::string output =
+    argc > 2 ? argv[2] : "data/trainingsample_condensed.csv";
+  training_set = slurp_file(input);
+  validation_set =  slurp_file("data/validationsample.csv");
+  if (training_set.empty()) {
+    std::cout << "Empty training set" << std::endl;
+    return 1;
+  }
+  result.resize(training_set.size());
+  buffer<int> training_buffer = get_buffer(training_set);
+  buffer<int> result_buffer { result.data(), result.size() };
+
+  // A SYCL queue to send the heterogeneous work-load to
+  queue q;
+
+  auto edited = edit(training_buffer, result_buffer, q);
+  auto condensed = condense(training_buffer, result_buffer, q, edited);
+
+  auto edited_size = std::count(edited.begin(), edited.end(), true);
+  auto condensed_size = std::count(condensed.begin(), condensed.end(), true);
+  if (condensed_size == 0) {
+    std::cout << "Editing dropped every training image" << std::endl;
+    return 1;
+  }
+
+  if (!dump_file(output, training_set, condensed)) {
+    std::cout << "Cannot write " << output << std::endl;
+    return 1;
+  }
+
+  // Match each image from the validation set against the full and the
+  // condensed training sets, with the same distances
+  std::vector<bool> all(training_set.size(), true);
+  int correct_full = 0;
+  int correct_condensed = 0;
+  for (auto const& img : validation_set) {
+    distances(training_buffer, result_buffer, img.pixels, q);
+    correct_full += training_set[nearest(all)].label == img.label;
+    correct_condensed += training_set[nearest(condensed)].label == img.label;
+  }
+
+  std::cout << "Training set : " << training_set.size() << " images\n"
+            << "\t| Edited : " << edited_size << " images\n"
+            << "\t| Condensed : " << condensed_size << " images ("
+            << (100.0*condensed_size/training_set.size())
+            << "% of the training set)\n"
+            << "\t| Written to " << output << std::endl;
+
+  if (!validation_set.empty())
+    std::cout << "Result full : "
+              << (100.0*correct_full/validation_set.size()) << "%\n"
+              << "Result condensed : "
+              << (100.0*correct_condensed/validation_set.size()) << "%"
+              << std::endl;
+  return 0;
+}
@@ -14,13 +14,13 @@
 
 #include <CL/sycl.hpp>
 
+#include "knn_cache.hpp"
+
 #define DEVICE_NUMBER 0
 
 using namespace cl::sycl;
 
-constexpr size_t training_set_size = 5000;
 constexpr size_t pixel_number = 784;
-range<1> global_size {5000};
 
 using Vector = std::array<int, pixel_number>;
 
@@ -33,7 +33,11 @@ struct Img {
 
 std::vector<Img> training_set;
 std::vector<Img> validation_set;
-int result[training_set_size];
+// Distances to each image of the training set
+std::vector<int> result;
+// Results of the previous searches, looked up before scanning the
+// training set
+knn_cache<Vector> cache;
 
 // Construct a SYCL buffer from a vector of images
 buffer<int> get_buffer(const std::vector<Img>& imgs) {
@@ -78,6 +82,12 @@ std::vector<Img> slurp_file(const std::string& name) {
 int search_image(buffer<int>& training, buffer<int>& res,
                  const Img& img, queue& q, const kernel& k) {
 
+  knn_cache<Vector>::entry cached;
+  std::size_t generation;
+  // A resubmitted image does not need to be searched again
+  if (cache.lookup(img.pixels, cached, generation))
+    return cached.label == img.label;
+
   {
     buffer<int> A { std::begin(img.pixels), std::end(img.pixels) };
     // Compute the L2 distance between an image and each one from the
@@ -91,25 +101,38 @@ int search_image(buffer<int>& training, buffer<int>& res,
         cgh.set_args(training.get_access<access::mode::read>(cgh),
                      A.get_access<access::mode::read>(cgh),
                      res.get_access<access::mode::discard_write>(cgh),
-                     int { training_set_size }, int { pixel_number });
-        // Launch the kernel with training_set_size work-items
-        cgh.parallel_for(global_size, k);
+                     static_cast<int>(training_set.size()),
+                     int { pixel_number });
+        // Launch the kernel with one work-item per training image
+        cgh.parallel_for(range<1> { training_set.size() }, k);
       });
   }
   auto r = res.get_access<access::mode::read>();
   // Find the image with the minimum distance
   auto min_image = std::min_element(std::begin(result), std::end(result));
 
+  std::size_t nearest = std::distance(std::begin(result), min_image);
+  cache.insert(img.pixels, { { nearest }, training_set[nearest].label },
+               generation);
+
   // Test if we found the good digit
-  return
-    training_set[std::distance(std::begin(result), min_image)].label == img.label;
+  return training_set[nearest].label == img.label;
 }
 
 int main(int argc, char* argv[]) {
-  training_set = slurp_file("data/trainingsample.csv");
+  // The training set, or a condensed version of it produced by
+  // knn_condense, can be given on the command line
+  training_set = slurp_file(argc > 1 ? argv[1] : "data/trainingsample.csv");
   validation_set =  slurp_file("data/validationsample.csv");
+  if (training_set.empty()) {
+    std::cout << "Empty training set" << std::endl;
+    return 1;
+  }
+  result.resize(training_set.size());
   buffer<int> training_buffer = get_buffer(training_set);
-  buffer<int> result_buffer { result, training_set_size };
+  // Cached results refer to the previous training set
+  cache.invalidate();
+  buffer<int> result_buffer { result.data(), result.size() };
 
   // Device selection
   auto devices = boost::compute::system::devices();
@@ -178,5 +201,8 @@ int main(int argc, char* argv[]) {
     correct = 0;
   }
   std::cout << "FINAL AVERAGE : " << (sum/1000) << std::endl;
+  if (cache.enabled())
+    std::cout << "CACHE : " << cache.hits() << " hits, "
+              << cache.misses() << " misses" << std::endl;
   return 0;
 }
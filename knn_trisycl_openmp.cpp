@@ -11,9 +11,10 @@
 
 #include <CL/sycl.hpp>
 
+#include "knn_cache.hpp"
+
 using namespace cl::sycl;
 
-constexpr size_t training_set_size = 5000;
 constexpr size_t pixel_number = 784;
 
 using Vector = std::array<int, pixel_number>;
@@ -29,7 +30,11 @@ struct Img {
 
 std::vector<Img> training_set;
 std::vector<Img> validation_set;
-int result[training_set_size];
+// Distances to each image of the training set
+std::vector<int> result;
+// Results of the previous searches, looked up before scanning the
+// training set
+knn_cache<Vector> cache;
 
 // Construct a SYCL buffer from a vector of images
 buffer<int> get_buffer(const std::vector<Img>& imgs) {
@@ -74,6 +79,12 @@ std::vector<Img> slurp_file(const std::string& name) {
 int search_image(buffer<int>& training, buffer<int>& res_buffer,
                  const Img& img, queue& q) {
 
+  knn_cache<Vector>::entry cached;
+  std::size_t generation;
+  // A resubmitted image does not need to be searched again
+  if (cache.lookup(img.pixels, cached, generation))
+    return cached.label == img.label;
+
   {
     buffer<int> A { std::begin(img.pixels), std::end(img.pixels) };
     // Compute the L2 distance between an image and each one from the
@@ -85,8 +96,8 @@ int search_image(buffer<int>& training, buffer<int>& res_buffer,
         auto train = training.get_access<access::mode::read>(cgh);
         auto ka = A.get_access<access::mode::read>(cgh);
         auto kb = res_buffer.get_access<access::mode::write>(cgh);
-        // Launch a kernel with training_set_size work-items
-        cgh.parallel_for<class KnnKernel>(range<1> { training_set_size },
+        // Launch a kernel with one work-item per training image
+        cgh.parallel_for<class KnnKernel>(range<1> { training_set.size() },
                                           [=] (id<1> index) {
             decltype(ka)::value_type diff = 0;
             // For each pixel
@@ -104,16 +115,28 @@ int search_image(buffer<int>& training, buffer<int>& res_buffer,
   // Find the image with the minimum distance
   auto min_image = std::min_element(std::begin(result), std::end(result));
 
+  std::size_t nearest = std::distance(std::begin(result), min_image);
+  cache.insert(img.pixels, { { nearest }, training_set[nearest].label },
+               generation);
+
   // Test if we found the good digit
-  return
-    training_set[std::distance(std::begin(result), min_image)].label == img.label;
+  return training_set[nearest].label == img.label;
 }
 
 int main(int argc, char* argv[]) {
-  training_set = slurp_file("data/trainingsample.csv");
+  // The training set, or a condensed version of it produced by
+  // knn_condense, can be given on the command line
+  training_set = slurp_file(argc > 1 ? argv[1] : "data/trainingsample.csv");
   validation_set =  slurp_file("data/validationsample.csv");
+  if (training_set.empty()) {
+    std::cout << "Empty training set" << std::endl;
+    return 1;
+  }
+  result.resize(training_set.size());
   buffer<int> training_buffer = get_buffer(training_set);
-  buffer<int> result_buffer { result, training_set_size };
+  // Cached results refer to the previous training set
+  cache.invalidate();
+  buffer<int> result_buffer { result.data(), result.size() };
 
   // A SYCL queue to send the heterogeneous work-load to
   queue q;
@@ -148,5 +171,8 @@ int main(int argc, char* argv[]) {
     correct = 0;
   }
   std::cout << "FINAL AVERAGE : " << (sum/1000) << std::endl;
+  if (cache.enabled())
+    std::cout << "CACHE : " << cache.hits() << " hits, "
+              << cache.misses() << " misses" << std::endl;
   return 0;
 }